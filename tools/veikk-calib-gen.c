@@ -0,0 +1,282 @@
+/**
+ * Calibration mesh generator for the veikk driver's calib_mesh sysfs
+ * attribute (see veikk_calib.c for the format). Reads tap-target samples and
+ * fits the mesh node offsets so that raw+offset(raw), with offset bilinearly
+ * interpolated over the mesh the same way the driver does, lands on the target.
+ * <p>
+ * Input (stdin or -i file): one sample per line, "raw_x raw_y target_x
+ * target_y", all in raw digitizer units ([0,x_max] by [0,y_max], before
+ * orientation/screen mapping); i.e., where the tablet reported the pen and
+ * where the tap target actually was. Lines starting with '#' are ignored.
+ * <p>
+ * The fit is a least-squares fit of the node offsets to the sample errors,
+ * plus a smoothness term (weight -s) penalizing differences between
+ * neighbouring nodes; the latter also fills in nodes without any samples
+ * nearby. The resulting blob is written to stdout (or -o file), so it can be
+ * uploaded with e.g.
+ *     veikk-calib-gen -c 9 -r 6 < samples.txt \
+ *         > /sys/bus/hid/devices/<device>/calib_mesh
+ * <p>
+ * usage: veikk-calib-gen [-c cols] [-r rows] [-x x_max] [-y y_max]
+ *                        [-s smoothness] [-i samples] [-o mesh]
+ * defaults: 9x6 mesh, VK1560 range (27536x15489), smoothness 0.1
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// keep in sync with veikk.h
+#define VEIKK_CALIB_MAX_NODES   31
+
+#define MAX_SWEEPS              20000
+#define TOLERANCE               1e-4
+
+struct sample {
+    double x, y, ex, ey;
+};
+
+// normal equations for one node: coefficients for its 3x3 neighbourhood
+// (including itself) and right-hand sides for both axes
+struct node_eq {
+    double a[3][3];
+    double bx, by;
+};
+
+static int cols = 9, rows = 6;
+static double x_max = 27536, y_max = 15489, smoothness = 0.1;
+
+// bilinear weights of the (up to) four nodes around (x, y), mirroring
+// veikk_calib_locate in the driver
+static void locate(double x, double y, int *i, int *j, double w[2][2]) {
+    double u = x*(cols-1)/x_max, v = y*(rows-1)/y_max;
+
+    u = u < 0 ? 0 : u;
+    v = v < 0 ? 0 : v;
+    *i = (int) u;
+    *j = (int) v;
+    if(*i >= cols-1)
+        *i = cols-2;
+    if(*j >= rows-1)
+        *j = rows-2;
+    u -= *i;
+    v -= *j;
+    if(u > 1)
+        u = 1;
+    if(v > 1)
+        v = 1;
+
+    w[0][0] = (1-u)*(1-v);
+    w[0][1] = u*(1-v);
+    w[1][0] = (1-u)*v;
+    w[1][1] = u*v;
+}
+
+static double interp(const double *o, double x, double y) {
+    double w[2][2];
+    int i, j;
+
+    locate(x, y, &i, &j, w);
+    return w[0][0]*o[j*cols+i] + w[0][1]*o[j*cols+i+1]
+         + w[1][0]*o[(j+1)*cols+i] + w[1][1]*o[(j+1)*cols+i+1];
+}
+
+static struct sample *read_samples(FILE *f, int *n) {
+    struct sample *s = NULL, *tmp;
+    double rx, ry, tx, ty;
+    char line[256];
+    int cap = 0;
+
+    *n = 0;
+    while(fgets(line, sizeof(line), f)) {
+        if(line[0] == '#' || sscanf(line, "%lf %lf %lf %lf",
+                                    &rx, &ry, &tx, &ty) != 4)
+            continue;
+        if(*n == cap) {
+            cap = cap ? 2*cap : 64;
+            if(!(tmp = realloc(s, cap*sizeof(*s)))) {
+                free(s);
+                return NULL;
+            }
+            s = tmp;
+        }
+        s[(*n)++] = (struct sample) { rx, ry, tx-rx, ty-ry };
+    }
+    return s;
+}
+
+// accumulate the normal equations of the least-squares problem
+static void build(struct node_eq *eq, const struct sample *s, int n) {
+    static const int nb[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+    double w[2][2];
+    int k, i, j, a, b, c, d, ni, nj;
+
+    for(k = 0; k < n; k++) {
+        locate(s[k].x, s[k].y, &i, &j, w);
+        for(b = 0; b < 2; b++)
+            for(a = 0; a < 2; a++) {
+                struct node_eq *e = &eq[(j+b)*cols+i+a];
+
+                e->bx += w[b][a]*s[k].ex;
+                e->by += w[b][a]*s[k].ey;
+                for(d = 0; d < 2; d++)
+                    for(c = 0; c < 2; c++)
+                        e->a[d-b+1][c-a+1] += w[b][a]*w[d][c];
+            }
+    }
+
+    // smoothness: lambda*sum over neighbouring pairs of (o_k-o_j)^2
+    for(j = 0; j < rows; j++)
+        for(i = 0; i < cols; i++)
+            for(k = 0; k < 4; k++) {
+                ni = i+nb[k][0];
+                nj = j+nb[k][1];
+                if(ni < 0 || ni >= cols || nj < 0 || nj >= rows)
+                    continue;
+                eq[j*cols+i].a[1][1] += smoothness;
+                eq[j*cols+i].a[nb[k][1]+1][nb[k][0]+1] -= smoothness;
+            }
+}
+
+// solve both axes with Gauss-Seidel; the system is symmetric positive
+// definite for smoothness>0
+static int solve(const struct node_eq *eq, double *ox, double *oy) {
+    double sx, sy, nx, ny, change;
+    int sweep, i, j, a, b, k;
+
+    for(sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+        change = 0;
+        for(j = 0; j < rows; j++)
+            for(i = 0; i < cols; i++) {
+                k = j*cols+i;
+                sx = eq[k].bx;
+                sy = eq[k].by;
+                for(b = -1; b <= 1; b++)
+                    for(a = -1; a <= 1; a++) {
+                        if((!a && !b) || i+a < 0 || i+a >= cols
+                           || j+b < 0 || j+b >= rows)
+                            continue;
+                        sx -= eq[k].a[b+1][a+1]*ox[k+b*cols+a];
+                        sy -= eq[k].a[b+1][a+1]*oy[k+b*cols+a];
+                    }
+                nx = sx/eq[k].a[1][1];
+                ny = sy/eq[k].a[1][1];
+                change = fmax(change, fmax(fabs(nx-ox[k]), fabs(ny-oy[k])));
+                ox[k] = nx;
+                oy[k] = ny;
+            }
+        if(change < TOLERANCE)
+            return 0;
+    }
+    return -1;
+}
+
+static void put_le16(unsigned char *p, int v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static int clamp_s16(double v) {
+    long r = lround(v);
+
+    return r < INT16_MIN ? INT16_MIN : r > INT16_MAX ? INT16_MAX : (int) r;
+}
+
+static double rms(const struct sample *s, int n, const double *ox,
+                  const double *oy) {
+    double sum = 0, dx, dy;
+    int k;
+
+    for(k = 0; k < n; k++) {
+        dx = s[k].ex - (ox ? interp(ox, s[k].x, s[k].y) : 0);
+        dy = s[k].ey - (oy ? interp(oy, s[k].x, s[k].y) : 0);
+        sum += dx*dx + dy*dy;
+    }
+    return sqrt(sum/n);
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin, *out = stdout;
+    struct node_eq *eq;
+    struct sample *s;
+    unsigned char blob[4+4*VEIKK_CALIB_MAX_NODES*VEIKK_CALIB_MAX_NODES];
+    double *ox, *oy;
+    size_t size;
+    int opt, n, k;
+
+    while((opt = getopt(argc, argv, "c:r:x:y:s:i:o:")) != -1)
+        switch(opt) {
+        case 'c': cols = atoi(optarg); break;
+        case 'r': rows = atoi(optarg); break;
+        case 'x': x_max = atof(optarg); break;
+        case 'y': y_max = atof(optarg); break;
+        case 's': smoothness = atof(optarg); break;
+        case 'i':
+            if(!(in = fopen(optarg, "r"))) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            if(!(out = fopen(optarg, "wb"))) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c cols] [-r rows] [-x x_max] "
+                            "[-y y_max] [-s smoothness] [-i samples] "
+                            "[-o mesh]\n", argv[0]);
+            return 2;
+        }
+    if(cols < 2 || cols > VEIKK_CALIB_MAX_NODES || rows < 2
+       || rows > VEIKK_CALIB_MAX_NODES || x_max <= 0 || y_max <= 0
+       || smoothness <= 0) {
+        fprintf(stderr, "need 2<=cols,rows<=%d, x_max,y_max>0 and "
+                        "smoothness>0\n", VEIKK_CALIB_MAX_NODES);
+        return 2;
+    }
+
+    if(!(s = read_samples(in, &n)) || !n) {
+        fprintf(stderr, "no samples\n");
+        return 1;
+    }
+
+    eq = calloc(cols*rows, sizeof(*eq));
+    ox = calloc(cols*rows, sizeof(*ox));
+    oy = calloc(cols*rows, sizeof(*oy));
+    if(!eq || !ox || !oy) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    build(eq, s, n);
+    if(solve(eq, ox, oy))
+        fprintf(stderr, "warning: fit did not converge\n");
+    fprintf(stderr, "%d samples; rms error %.1f -> %.1f (digitizer units)\n",
+            n, rms(s, n, NULL, NULL), rms(s, n, ox, oy));
+
+    // struct veikk_calib_mesh_hdr, then the nodes in row-major order; the
+    // driver needs the whole mesh in a single write
+    size = 4+4*cols*rows;
+    blob[0] = cols;
+    blob[1] = rows;
+    put_le16(blob+2, 0);
+    for(k = 0; k < cols*rows; k++) {
+        put_le16(blob+4+4*k, clamp_s16(ox[k]));
+        put_le16(blob+6+4*k, clamp_s16(oy[k]));
+    }
+
+    free(eq);
+    free(ox);
+    free(oy);
+    free(s);
+    if(write(fileno(out), blob, size) != (ssize_t) size || fclose(out)) {
+        perror("write");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,697 @@
+/**
+ * Hotplug/probe-time scaling benchmark for the veikk driver. Creates N virtual
+ * tablets through /dev/uhid (with a vendor/product id from veikk_ids, so that
+ * the veikk driver binds to them), all at once, then writes a module parameter
+ * (which fans out to every connected device) and finally destroys all the
+ * devices at once. This is repeated for increasing N to get scaling curves.
+ * <p>
+ * Measured per device, relative to the start of the phase:
+ * - input:  the device's input_dev shows up in /sys/class/input (this happens
+ *           in the middle of veikk_probe)
+ * - start:  uhid receives UHID_START (hid_hw_start in veikk_probe)
+ * - bound:  the device shows up under /sys/bus/hid/drivers/veikk (veikk_probe
+ *           returned successfully)
+ * - param:  a re-registered input_dev shows up after the parameter write
+ * - unbind: the device is gone from /sys/bus/hid/drivers/veikk after
+ *           UHID_DESTROY
+ * The duration of the parameter write itself is also reported; module
+ * parameter setters update all devices before returning.
+ * <p>
+ * Between the parameter write and the removal, another N devices are created
+ * and then destroyed while a thread keeps rewriting the parameter, so that
+ * their probes and removes overlap the fan-out over the first N devices
+ * (veikk_update_vdevs holding vdevs_mutex). Their bound/unbind times are
+ * reported as cbound/cunbind, along with the number of parameter writes that
+ * completed meanwhile (cwrites).
+ * <p>
+ * "par" is the achieved probe parallelism, i.e., N times the (best) time to
+ * probe a single device divided by the wall time until all N devices were
+ * bound. It stays close to 1 if probes are serialized (e.g., on vdevs_mutex)
+ * and approaches N if they run fully in parallel; with -c, the tool fails if
+ * it drops below the given threshold for any N>=4.
+ * <p>
+ * With -i, the tool instead measures the report path: it creates max_devices
+ * devices, opens their event nodes (like a client would, so that events are
+ * actually delivered), and injects UHID_INPUT2 pen reports into all of them
+ * for the given number of seconds, each device from its own thread, either
+ * as fast as possible or at -f reports per second per device. It reports the
+ * number of injected reports, the achieved report rate and the number of
+ * frames (SYN_REPORTs) received on the event nodes. Run it under e.g.
+ *     perf stat -a -e cache-misses,L1-dcache-load-misses -- \
+ *         veikk-hotplug-bench -n 8 -i 10
+ * to compare the cache behaviour of the report path between driver builds.
+ * <p>
+ * Needs root and the veikk module loaded. Devices are identified through their
+ * uniq string ("veikk-bench-<pid>-<i>"), which veikk copies to its input_devs.
+ * <p>
+ * usage: veikk-hotplug-bench [-n max_devices] [-r rounds] [-p product_id]
+ *                            [-c min_parallelism] [-t timeout_ms]
+ *                            [-i inject_seconds] [-f inject_rate_hz]
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#define VEIKK_VENDOR_ID     0x2FEB
+#define MAX_DEVICES         256
+#define UNIQ_FMT            "veikk-bench-%d-%d"
+#define INPUT_DIR           "/sys/class/input"
+#define DRIVER_DIR          "/sys/bus/hid/drivers/veikk"
+#define PARAM_PATH          "/sys/module/veikk/parameters/orientation"
+
+// report descriptor matching struct veikk_pen_report (report id, buttons,
+// 16-bit x, y, pressure)
+static const unsigned char veikk_rdesc[] = {
+    0x05, 0x0D,         // Usage Page (Digitizer)
+    0x09, 0x02,         // Usage (Pen)
+    0xA1, 0x01,         // Collection (Application)
+    0x85, 0x01,         //   Report ID (1)
+    0x09, 0x20,         //   Usage (Stylus)
+    0xA1, 0x00,         //   Collection (Physical)
+    0x09, 0x42,         //     Usage (Tip Switch)
+    0x09, 0x44,         //     Usage (Barrel Switch)
+    0x09, 0x45,         //     Usage (Eraser)
+    0x15, 0x00,         //     Logical Minimum (0)
+    0x25, 0x01,         //     Logical Maximum (1)
+    0x75, 0x01,         //     Report Size (1)
+    0x95, 0x03,         //     Report Count (3)
+    0x81, 0x02,         //     Input (Data,Var,Abs)
+    0x95, 0x05,         //     Report Count (5)
+    0x81, 0x03,         //     Input (Const,Var,Abs)
+    0x05, 0x01,         //     Usage Page (Generic Desktop)
+    0x09, 0x30,         //     Usage (X)
+    0x09, 0x31,         //     Usage (Y)
+    0x26, 0xFF, 0x7F,   //     Logical Maximum (32767)
+    0x75, 0x10,         //     Report Size (16)
+    0x95, 0x02,         //     Report Count (2)
+    0x81, 0x02,         //     Input (Data,Var,Abs)
+    0x05, 0x0D,         //     Usage Page (Digitizer)
+    0x09, 0x30,         //     Usage (Tip Pressure)
+    0x26, 0xFF, 0x1F,   //     Logical Maximum (8191)
+    0x95, 0x01,         //     Report Count (1)
+    0x81, 0x02,         //     Input (Data,Var,Abs)
+    0xC0,               //   End Collection
+    0xC0                // End Collection
+};
+
+enum bench_event {
+    EV_INPUT,
+    EV_START,
+    EV_BOUND,
+    EV_PARAM,
+    EV_UNBIND,
+    EV_COUNT
+};
+static const char *const bench_event_names[EV_COUNT] = {
+    "input", "start", "bound", "param", "unbind"
+};
+
+struct bench_dev {
+    int fd;
+    pthread_t thread, injector;
+    // number of reports injected
+    long long injected;
+    // max input number seen for this device; used to detect re-registration
+    int last_input;
+    // event times in ns relative to the start of the current phase; 0 if
+    // the event hasn't happened yet
+    long long t[EV_COUNT];
+};
+
+static struct bench_dev devs[MAX_DEVICES];
+static int ndevs, product_id = 0x0001, timeout_ms = 10000;
+static long long phase_start, single_probe_wall;
+static volatile int stop_readers, stop_writer, writer_started, stop_drain;
+static int evfds[2*MAX_DEVICES], nevfds, inject_hz;
+static long long inject_ns, frames_received;
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+static void record(struct bench_dev *dev, enum bench_event ev) {
+    if(!dev->t[ev])
+        dev->t[ev] = now_ns()-phase_start;
+}
+
+// map a uniq string back to one of our devices, or NULL
+static struct bench_dev *dev_by_uniq(const char *uniq) {
+    int pid, i;
+
+    if(sscanf(uniq, UNIQ_FMT, &pid, &i) != 2 || pid != getpid()
+       || i < 0 || i >= ndevs)
+        return NULL;
+    return &devs[i];
+}
+
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f;
+    int ok;
+
+    if(!(f = fopen(path, "r")))
+        return -1;
+    ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    if(!ok)
+        return -1;
+    buf[strcspn(buf, "\n")] = 0;
+    return 0;
+}
+
+// scan input devices; calls fn for each of our devices with the input number
+static void scan_inputs(void (*fn)(struct bench_dev *dev, int num)) {
+    char path[PATH_MAX], uniq[128];
+    struct bench_dev *dev;
+    struct dirent *de;
+    DIR *d;
+    int num;
+
+    if(!(d = opendir(INPUT_DIR)))
+        return;
+    while((de = readdir(d)))
+        if(sscanf(de->d_name, "input%d", &num) == 1) {
+            snprintf(path, sizeof(path), INPUT_DIR "/%s/uniq", de->d_name);
+            if(!read_line(path, uniq, sizeof(uniq))
+               && (dev = dev_by_uniq(uniq)))
+                fn(dev, num);
+        }
+    closedir(d);
+}
+
+// scan devices bound to the veikk driver; marks seen[i] for each of ours
+static void scan_bound(int *seen) {
+    char path[PATH_MAX], line[256];
+    struct bench_dev *dev;
+    struct dirent *de;
+    FILE *f;
+    DIR *d;
+
+    memset(seen, 0, sizeof(int)*ndevs);
+    if(!(d = opendir(DRIVER_DIR)))
+        return;
+    while((de = readdir(d))) {
+        if(strncmp(de->d_name, "0003:", 5))
+            continue;
+        snprintf(path, sizeof(path), DRIVER_DIR "/%s/uevent", de->d_name);
+        if(!(f = fopen(path, "r")))
+            continue;
+        while(fgets(line, sizeof(line), f))
+            if(!strncmp(line, "HID_UNIQ=", 9)) {
+                line[strcspn(line, "\n")] = 0;
+                if((dev = dev_by_uniq(line+9)))
+                    seen[dev-devs] = 1;
+            }
+        fclose(f);
+    }
+    closedir(d);
+}
+
+static void on_input_probe(struct bench_dev *dev, int num) {
+    record(dev, EV_INPUT);
+    if(num > dev->last_input)
+        dev->last_input = num;
+}
+static void on_input_param(struct bench_dev *dev, int num) {
+    if(num > dev->last_input)
+        record(dev, EV_PARAM);
+}
+
+// per-device uhid event reader; records UHID_START
+static void *reader(void *arg) {
+    struct bench_dev *dev = arg;
+    struct pollfd pfd = { .fd = dev->fd, .events = POLLIN };
+    struct uhid_event ev;
+
+    while(!stop_readers) {
+        if(poll(&pfd, 1, 10) <= 0)
+            continue;
+        if(read(dev->fd, &ev, sizeof(ev)) <= 0)
+            break;
+        if(ev.type == UHID_START)
+            record(dev, EV_START);
+    }
+    return NULL;
+}
+
+static int create_dev(int i) {
+    struct uhid_event ev;
+    struct bench_dev *dev = &devs[i];
+
+    if((dev->fd = open("/dev/uhid", O_RDWR|O_CLOEXEC)) < 0)
+        return -errno;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *) ev.u.create2.name, sizeof(ev.u.create2.name),
+             "veikk-bench %d", i);
+    snprintf((char *) ev.u.create2.uniq, sizeof(ev.u.create2.uniq),
+             UNIQ_FMT, getpid(), i);
+    ev.u.create2.rd_size = sizeof(veikk_rdesc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = VEIKK_VENDOR_ID;
+    ev.u.create2.product = product_id;
+    memcpy(ev.u.create2.rd_data, veikk_rdesc, sizeof(veikk_rdesc));
+
+    if(write(dev->fd, &ev, sizeof(ev)) != sizeof(ev))
+        return -errno;
+    return 0;
+}
+
+static void destroy_dev(int i) {
+    struct uhid_event ev = { .type = UHID_DESTROY };
+
+    if(write(devs[i].fd, &ev, sizeof(ev)) != sizeof(ev))
+        perror("UHID_DESTROY");
+}
+
+// poll sysfs until done(i) holds for devices [first, last) or timeout; returns
+// the wall time of the phase in ns, or -1 on timeout
+static long long wait_all(int first, int last, int (*done)(int i),
+                          void (*scan)(void)) {
+    int i, all;
+
+    for(;;) {
+        scan();
+        for(all = 1, i = first; i < last && all; i++)
+            all = done(i);
+        if(all)
+            return now_ns()-phase_start;
+        if(now_ns()-phase_start > timeout_ms*1000000LL)
+            return -1;
+        usleep(100);
+    }
+}
+
+static int bound_seen[MAX_DEVICES];
+static void scan_probe(void) {
+    int i;
+
+    scan_inputs(on_input_probe);
+    scan_bound(bound_seen);
+    for(i = 0; i < ndevs; i++)
+        if(bound_seen[i])
+            record(&devs[i], EV_BOUND);
+}
+static void scan_param(void) {
+    scan_inputs(on_input_param);
+}
+static void scan_unbind(void) {
+    int i;
+
+    scan_bound(bound_seen);
+    for(i = 0; i < ndevs; i++)
+        if(!bound_seen[i])
+            record(&devs[i], EV_UNBIND);
+}
+static int probe_done(int i) {
+    return devs[i].t[EV_BOUND] && devs[i].t[EV_INPUT];
+}
+static int param_done(int i) {
+    return devs[i].t[EV_PARAM] != 0;
+}
+static int unbind_done(int i) {
+    return devs[i].t[EV_UNBIND] != 0;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *) a, y = *(const long long *) b;
+
+    return (x > y) - (x < y);
+}
+
+// print median/p95/max of an event over devices [first, first+n), in
+// microseconds
+static void print_stats(int ev, int first, int n) {
+    long long v[MAX_DEVICES];
+    int i;
+
+    for(i = 0; i < n; i++)
+        v[i] = devs[first+i].t[ev];
+    qsort(v, n, sizeof(v[0]), cmp_ll);
+    printf(" %11lld %11lld %11lld", v[n/2]/1000, v[(n*95)/100]/1000,
+           v[n-1]/1000);
+}
+
+static void print_label(const char *prefix, const char *name) {
+    static const char *const stats[] = { "med", "p95", "max" };
+    char label[32];
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        snprintf(label, sizeof(label), "%s%s.%s", prefix, name, stats[i]);
+        printf(" %11s", label);
+    }
+}
+
+static int write_param(const char *val) {
+    int fd, ret = 0;
+
+    if((fd = open(PARAM_PATH, O_WRONLY)) < 0)
+        return -errno;
+    if(write(fd, val, strlen(val)) < 0)
+        ret = -errno;
+    close(fd);
+    return ret;
+}
+
+// keeps alternating the parameter between vals[0] and vals[1] until stopped;
+// returns the number of completed writes
+static void *param_writer(void *arg) {
+    const char *const *vals = arg;
+    long k, error;
+
+    writer_started = 1;
+    for(k = 0; !stop_writer; k++)
+        if((error = write_param(vals[k&1]))) {
+            fprintf(stderr, "parameter write: %s\n", strerror(-error));
+            break;
+        }
+    return (void *) k;
+}
+
+static void put_le16(unsigned char *p, int v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+// injects pen reports into one device until the end of the phase; the pen
+// sweeps across the tablet and alternates between hovering and touching every
+// 256 reports, so that both the position and the button paths are exercised
+static void *injector(void *arg) {
+    struct bench_dev *dev = arg;
+    struct uhid_event ev;
+    struct timespec next;
+    // only the used part of the event needs to be written
+    size_t size = offsetof(struct uhid_event, u.input2.data)+8;
+    unsigned char *data = ev.u.input2.data;
+    long long k, end = phase_start+inject_ns;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = 8;
+    data[0] = 1;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for(k = 0; now_ns() < end; k++) {
+        data[1] = (k >> 8) & 1;
+        put_le16(data+2, (k*37) & 0x7FFF);
+        put_le16(data+4, (k*23) & 0x7FFF);
+        put_le16(data+6, data[1] ? (k*13) & 0x1FFF : 0);
+        if(write(dev->fd, &ev, size) != (ssize_t) size) {
+            perror("UHID_INPUT2");
+            break;
+        }
+        if(inject_hz) {
+            next.tv_nsec += 1000000000L/inject_hz;
+            if(next.tv_nsec >= 1000000000L) {
+                next.tv_sec++;
+                next.tv_nsec -= 1000000000L;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+    dev->injected = k;
+    return NULL;
+}
+
+// opens the event node of one of our input devices
+static void open_events(struct bench_dev *dev, int num) {
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d;
+
+    (void) dev;
+    snprintf(path, sizeof(path), INPUT_DIR "/input%d", num);
+    if(!(d = opendir(path)))
+        return;
+    while((de = readdir(d)))
+        if(!strncmp(de->d_name, "event", 5)
+           && nevfds < (int) (sizeof(evfds)/sizeof(evfds[0]))) {
+            snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+            if((evfds[nevfds] = open(path, O_RDONLY|O_NONBLOCK|O_CLOEXEC))
+               >= 0)
+                nevfds++;
+        }
+    closedir(d);
+}
+
+// reads and discards events from all opened event nodes; counts frames
+static void *drain(void *arg) {
+    struct pollfd pfds[2*MAX_DEVICES];
+    struct input_event ev[64];
+    ssize_t len;
+    int i, j;
+
+    (void) arg;
+    for(i = 0; i < nevfds; i++)
+        pfds[i] = (struct pollfd) { .fd = evfds[i], .events = POLLIN };
+    while(!stop_drain) {
+        if(poll(pfds, nevfds, 10) <= 0)
+            continue;
+        for(i = 0; i < nevfds; i++)
+            if(pfds[i].revents & POLLIN)
+                while((len = read(evfds[i], ev, sizeof(ev))) > 0)
+                    for(j = 0; j < len/(ssize_t) sizeof(ev[0]); j++)
+                        if(ev[j].type == EV_SYN && ev[j].code == SYN_REPORT)
+                            frames_received++;
+    }
+    return NULL;
+}
+
+static int create_devs(int first, int last) {
+    int i, error;
+
+    for(i = first; i < last; i++) {
+        if((error = create_dev(i))) {
+            fprintf(stderr, "UHID_CREATE2: %s\n", strerror(-error));
+            return -1;
+        }
+        pthread_create(&devs[i].thread, NULL, reader, &devs[i]);
+    }
+    return 0;
+}
+
+// one round with n devices; returns the achieved probe parallelism, or -1
+static double run_round(int n) {
+    long long probe_wall, param_wall, unbind_wall, cprobe_wall, cunbind_wall;
+    const char *vals[2];
+    double par;
+    char orientation[16];
+    pthread_t writer;
+    void *writes;
+    int i, error, created = n;
+
+    // devices [0, n) for the main phases, [n, 2n) for the contended ones
+    ndevs = 2*n;
+    memset(devs, 0, sizeof(devs));
+    for(i = 0; i < ndevs; i++)
+        devs[i].last_input = -1;
+
+    // probe: create all devices as quickly as possible
+    stop_readers = 0;
+    phase_start = now_ns();
+    if(create_devs(0, n))
+        return -1;
+    probe_wall = wait_all(0, n, probe_done, scan_probe);
+
+    // parameter fan-out: toggle orientation and back
+    if(read_line(PARAM_PATH, orientation, sizeof(orientation)))
+        strcpy(orientation, "0");
+    vals[0] = strcmp(orientation, "0") ? "0" : "1";
+    vals[1] = orientation;
+    phase_start = now_ns();
+    error = write_param(vals[0]);
+    param_wall = now_ns()-phase_start;
+    if(!error)
+        wait_all(0, n, param_done, scan_param);
+    else
+        fprintf(stderr, "parameter write: %s\n", strerror(-error));
+    write_param(orientation);
+
+    // contended hotplug: create and destroy devices [n, 2n) while the
+    // parameter keeps being rewritten for devices [0, n)
+    cprobe_wall = cunbind_wall = -1;
+    stop_writer = writer_started = 0;
+    pthread_create(&writer, NULL, param_writer, vals);
+    while(!writer_started)
+        usleep(10);
+    phase_start = now_ns();
+    if(!create_devs(n, 2*n)) {
+        created = 2*n;
+        cprobe_wall = wait_all(n, 2*n, probe_done, scan_probe);
+        phase_start = now_ns();
+        for(i = n; i < 2*n; i++)
+            destroy_dev(i);
+        cunbind_wall = wait_all(n, 2*n, unbind_done, scan_unbind);
+    }
+    stop_writer = 1;
+    pthread_join(writer, &writes);
+    write_param(orientation);
+
+    // remove: destroy all devices as quickly as possible
+    phase_start = now_ns();
+    for(i = 0; i < n; i++)
+        destroy_dev(i);
+    unbind_wall = wait_all(0, n, unbind_done, scan_unbind);
+
+    stop_readers = 1;
+    for(i = 0; i < created; i++) {
+        pthread_join(devs[i].thread, NULL);
+        close(devs[i].fd);
+    }
+
+    if(probe_wall < 0 || unbind_wall < 0 || cprobe_wall < 0
+       || cunbind_wall < 0) {
+        fprintf(stderr, "timed out with %d devices (is veikk loaded?)\n", n);
+        return -1;
+    }
+
+    // rounds with a single device come first and give the baseline
+    if(n == 1 && (!single_probe_wall || probe_wall < single_probe_wall))
+        single_probe_wall = probe_wall;
+    par = (double) n*single_probe_wall/probe_wall;
+
+    printf("%4d %10lld", n, probe_wall/1000);
+    for(i = 0; i < EV_COUNT; i++)
+        print_stats(i, 0, n);
+    print_stats(EV_BOUND, n, n);
+    print_stats(EV_UNBIND, n, n);
+    printf(" %10lld %10lld %7ld %6.2f\n", param_wall/1000, unbind_wall/1000,
+           (long) writes, par);
+    return par;
+}
+
+// report injection with n devices; returns 0, or -1 on error
+static int run_inject(int n) {
+    long long wall, injected = 0;
+    pthread_t drainer;
+    int i, ret = 0;
+
+    ndevs = n;
+    memset(devs, 0, sizeof(devs));
+    for(i = 0; i < n; i++)
+        devs[i].last_input = -1;
+
+    stop_readers = 0;
+    phase_start = now_ns();
+    if(create_devs(0, n))
+        return -1;
+    if(wait_all(0, n, probe_done, scan_probe) < 0) {
+        fprintf(stderr, "timed out with %d devices (is veikk loaded?)\n", n);
+        ret = -1;
+        goto out;
+    }
+
+    nevfds = 0;
+    scan_inputs(open_events);
+    frames_received = 0;
+    stop_drain = 0;
+    pthread_create(&drainer, NULL, drain, NULL);
+
+    phase_start = now_ns();
+    for(i = 0; i < n; i++)
+        pthread_create(&devs[i].injector, NULL, injector, &devs[i]);
+    for(i = 0; i < n; i++) {
+        pthread_join(devs[i].injector, NULL);
+        injected += devs[i].injected;
+    }
+    wall = now_ns()-phase_start;
+
+    // let the last (possibly coalesced) frames arrive
+    usleep(100000);
+    stop_drain = 1;
+    pthread_join(drainer, NULL);
+    for(i = 0; i < nevfds; i++)
+        close(evfds[i]);
+
+    printf("%4s %10s %12s %12s %12s\n",
+           "n", "wall", "injected", "reports/s", "frames");
+    printf("%4d %10lld %12lld %12.0f %12lld\n", n, wall/1000, injected,
+           injected*1e9/wall, frames_received);
+
+out:
+    phase_start = now_ns();
+    for(i = 0; i < n; i++)
+        destroy_dev(i);
+    wait_all(0, n, unbind_done, scan_unbind);
+    stop_readers = 1;
+    for(i = 0; i < n; i++) {
+        pthread_join(devs[i].thread, NULL);
+        close(devs[i].fd);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    int opt, n, r, rounds = 3, max_devs = 32, failed = 0;
+    double min_par = 0, inject_s = 0, par;
+
+    while((opt = getopt(argc, argv, "n:r:p:c:t:i:f:")) != -1)
+        switch(opt) {
+        case 'n': max_devs = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'p': product_id = strtol(optarg, NULL, 0); break;
+        case 'c': min_par = atof(optarg); break;
+        case 't': timeout_ms = atoi(optarg); break;
+        case 'i': inject_s = atof(optarg); break;
+        case 'f': inject_hz = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n max_devices] [-r rounds] "
+                            "[-p product_id] [-c min_parallelism] "
+                            "[-t timeout_ms] [-i inject_seconds] "
+                            "[-f inject_rate_hz]\n", argv[0]);
+            return 2;
+        }
+    if(max_devs < 1 || max_devs > MAX_DEVICES/2) {
+        fprintf(stderr, "max_devices must be in [1, %d]\n", MAX_DEVICES/2);
+        return 2;
+    }
+    if(inject_s < 0 || inject_hz < 0) {
+        fprintf(stderr, "inject_seconds and inject_rate_hz must be "
+                        "non-negative\n");
+        return 2;
+    }
+
+    // report injection instead of the hotplug rounds
+    if(inject_s) {
+        inject_ns = inject_s*1e9;
+        return run_inject(max_devs) ? 1 : 0;
+    }
+
+    // all times in microseconds; per-event columns are median/p95/max
+    printf("%4s %10s", "n", "probe");
+    for(n = 0; n < EV_COUNT; n++)
+        print_label("", bench_event_names[n]);
+    print_label("c", "bound");
+    print_label("c", "unbind");
+    printf(" %10s %10s %7s %6s\n", "write", "remove", "cwrites", "par");
+
+    // n = 1, 2, 4, ..., max_devs
+    for(n = 1; n <= max_devs; n = (n < max_devs && n*2 > max_devs)
+                                  ? max_devs : n*2)
+        for(r = 0; r < rounds; r++) {
+            if((par = run_round(n)) < 0)
+                return 1;
+            if(min_par && n >= 4 && par < min_par) {
+                fprintf(stderr, "n=%d: probe parallelism %.2f < %.2f; "
+                                "probes look serialized\n", n, par, min_par);
+                failed = 1;
+            }
+        }
+    return failed;
+}
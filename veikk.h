@@ -7,8 +7,11 @@
 #ifndef VEIKK_H
 #define VEIKK_H
 
+#include <linux/cache.h>
 #include <linux/hid.h>
+#include <linux/hrtimer.h>
 #include <linux/input.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 #include <linux/usb.h>
 
@@ -60,6 +63,16 @@ enum veikk_orientation {
     VEIKK_OR_CW
 };
 
+// calibration mesh header; see veikk_calib.c for the full upload format. The
+// maximum mesh is 31x31 so that the whole blob fits in a single sysfs write
+#define VEIKK_CALIB_MAX_NODES   31
+#define VEIKK_CALIB_MESH_SIZE(cols, rows)\
+    (sizeof(struct veikk_calib_mesh_hdr)+4*(cols)*(rows))
+struct veikk_calib_mesh_hdr {
+    u8 cols, rows;
+    u16 reserved;
+};
+
 // pen input report -- structure of input report from tablet
 struct veikk_pen_report {
     u8 report_id;
@@ -86,10 +99,72 @@ struct veikk_device_info {
     int (*handle_raw_data)(struct veikk *veikk, u8 *data, int size,
                            unsigned int report_id);
     int (*handle_modparm_change)(struct veikk *veikk);
+    void (*emit_pen_report)(struct veikk *veikk,
+                            const struct veikk_pen_report *pen_report);
+};
+
+struct veikk_calib_mesh;
+
+// per-report ("hot") mapping state of a device: the input_dev and everything
+// needed to turn a pen report into events, packed together into a single
+// cache line. Filled in from module parameters/device info on
+// (re-)registration, so that the mapping doesn't have to read the global
+// parameters. Handler dispatch (vdinfo), report_lock, the coalescing state
+// and the relative mode state other than the mode itself are not part of it
+// and live in the rest of struct veikk.
+// Check the layout with `pahole -C veikk_hot veikk.ko`; its size is also
+// asserted at compile time in veikk_drv.c
+struct veikk_hot {
+    struct input_dev *pen_input;
+
+    // nonlinear calibration mesh uploaded through sysfs; NULL if none
+    struct veikk_calib_mesh __rcu *calib_mesh;
+
+    // per-device copy of the pressure_map module parameter
+    struct veikk_pressure_map pressure_map;
+    s32 pressure_max;
+
+    // minimum interval between emitted frames; see veikk_coalesce.c
+    u32 coalesce_us;
+
+    // these are used for orientation mapping
+    u8 x_map_axis, y_map_axis;
+    s8 x_map_dir, y_map_dir;
+
+    // button mask of the last emitted frame
+    u8 last_buttons;
+
+    // requested relative mode (0 for absolute/pen, 1 for relative/mouse; set
+    // through sysfs), and the mode currently in effect; the report path
+    // switches when they differ. See veikk_rel.c
+    u8 rel_mode;
+    bool rel_active;
+};
+
+// relative (mouse) mode state, except for the mode itself (in struct
+// veikk_hot); see veikk_rel.c. Only touched from the report path (under
+// report_lock), except for the acceleration parameters (set through sysfs)
+struct veikk_rel {
+    // mouse input_dev used in relative mode
+    struct input_dev *input;
+
+    // false until a reference position is known (after a reset)
+    bool tracking;
+    int last_x, last_y;
+    s32 rem_x, rem_y;
+    u8 buttons;
+    ktime_t last_report;
+
+    // acceleration curve parameters
+    u32 gain, accel, threshold;
 };
 
 // common properties for veikk devices
 struct veikk {
+    // per-report state; kept first and cacheline-aligned (see veikk_probe
+    // for how the alignment of struct veikk itself is guaranteed)
+    struct veikk_hot hot ____cacheline_aligned;
+
     // hardware details
     struct hid_device *hdev;
 
@@ -99,11 +174,20 @@ struct veikk {
     // mapped digitizer characteristics; initialized with defaults from
     // struct veikk_device_info
     struct veikk_rect map_rect;
-    int pressure_map[4];
-    // these are used for orientation mapping
-    int x_map_axis, y_map_axis, x_map_dir, y_map_dir;
 
-    struct input_dev *pen_input;
+    // report coalescing state; see veikk_coalesce.c. report_lock protects
+    // these and last_buttons, and serializes all frame emission
+    spinlock_t report_lock;
+    struct hrtimer coalesce_timer;
+    ktime_t last_emit;
+    struct veikk_pen_report pending_report;
+    bool has_pending_report;
+    // set while the input_devs are being torn down/re-registered
+    bool emit_blocked;
+    u64 reports_coalesced, frames_emitted;
+
+    struct veikk_rel rel;
+
     struct list_head lh;
 };
 
@@ -131,4 +215,26 @@ void veikk_configure_input_devs(struct veikk_rect ss,
 // calculate pressure map -- for use in raw_event handler
 int veikk_map_pressure(s64 pres, s64 pres_max,
                        struct veikk_pressure_map *coef);
+
+// from veikk_calib.c
+extern struct bin_attribute bin_attr_calib_mesh;
+void veikk_calib_apply(struct veikk *veikk, int *x, int *y);
+void veikk_calib_free(struct veikk *veikk);
+
+// from veikk_coalesce.c
+extern struct device_attribute dev_attr_coalesce_us;
+extern struct device_attribute dev_attr_reports_coalesced;
+extern struct device_attribute dev_attr_frames_emitted;
+void veikk_coalesce_init(struct veikk *veikk);
+void veikk_coalesce_block(struct veikk *veikk);
+void veikk_coalesce_unblock(struct veikk *veikk);
+void veikk_coalesce_pen_report(struct veikk *veikk,
+                               const struct veikk_pen_report *pen_report);
+
+// from veikk_rel.c
+extern struct device_attribute dev_attr_relative_mode;
+extern struct device_attribute dev_attr_relative_accel;
+void veikk_rel_init(struct veikk *veikk);
+void veikk_rel_reset(struct veikk *veikk);
+void veikk_rel_report(struct veikk *veikk, int x, int y, u8 buttons);
 #endif
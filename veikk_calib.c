@@ -0,0 +1,241 @@
+/**
+ * Per-device nonlinear calibration mesh. Exposes a binary sysfs attribute
+ * (calib_mesh, in the hid device's sysfs directory) through which userspace
+ * uploads a grid of correction offsets; these offsets are then applied to the
+ * raw pen coordinates in the report path using bilinear interpolation.
+ * <p>
+ * The grid covers the full physical range of the digitizer ([0,x_max] by
+ * [0,y_max]) with cols by rows evenly-spaced nodes. Each node holds the offset
+ * (in raw digitizer units) to be added to a pen report at that position. This
+ * is meant to correct parallax/sensor nonlinearity on pen displays (e.g., the
+ * VK1560) that a single rectangular screen mapping can't correct.
+ * <p>
+ * format: struct veikk_calib_mesh_hdr followed by cols*rows nodes in row-major
+ *         order, each node being two little-endian s16 (dx, dy); i.e., a
+ *         total of 4+4*cols*rows bytes written in a single write at offset 0
+ *         (kernfs splits binary attribute writes into PAGE_SIZE chunks, so
+ *         VEIKK_CALIB_MAX_NODES is chosen such that the largest mesh fits in
+ *         one page)
+ * valid values: 2<=cols,rows<=VEIKK_CALIB_MAX_NODES; or cols=rows=0 (header
+ *               only) to remove the mesh; the header's reserved field must be 0
+ * default: no mesh (no correction)
+ * <p>
+ * All the per-cell work (differences between neighbouring nodes and the
+ * scaling from digitizer units to cell coordinates) is done once on upload,
+ * so each report only costs a handful of multiplies and shifts regardless of
+ * the size of the mesh.
+ */
+
+#include <asm/unaligned.h>
+#include <linux/math64.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include "veikk.h"
+
+// fixed-point precision of the cell coordinates (16.16)
+#define VEIKK_CALIB_FRAC_BITS   16
+#define VEIKK_CALIB_ONE         (1<<VEIKK_CALIB_FRAC_BITS)
+
+// bilinear coefficients for one axis of one cell; the offset at cell
+// coordinates (u,v) in [0,1]x[0,1] is a+b*u+c*v+d*u*v
+struct veikk_calib_coef {
+    s32 a, b, c, d;
+};
+struct veikk_calib_cell {
+    struct veikk_calib_coef dx, dy;
+};
+
+// an uploaded mesh; replaced as a whole (RCU) when a new one is uploaded, so
+// the report path never sees a partially-updated mesh
+struct veikk_calib_mesh {
+    struct rcu_head rcu;
+
+    // Q32 scale factors converting raw digitizer units to 16.16 cell
+    // coordinates, i.e., ((cols-1)<<32)/x_max and ((rows-1)<<32)/y_max
+    u64 x_scale, y_scale;
+    int cols, rows;
+
+    // physical range of the digitizer, copied here so that the report path
+    // doesn't have to look at the device info
+    int x_max, y_max;
+
+    // copy of the uploaded blob, for reading back through sysfs
+    u8 *blob;
+    size_t blob_size;
+
+    // (cols-1)*(rows-1) cells, row-major
+    struct veikk_calib_cell cells[];
+};
+
+// a mesh has to arrive in a single write; see format above
+static_assert(VEIKK_CALIB_MESH_SIZE(VEIKK_CALIB_MAX_NODES,
+                                    VEIKK_CALIB_MAX_NODES) <= PAGE_SIZE);
+
+// serializes writers; readers (the report path) only use RCU
+static DEFINE_MUTEX(veikk_calib_mutex);
+
+// offset of the ith node in the uploaded blob
+static inline s16 veikk_calib_node(const u8 *nodes, int i, int axis) {
+    return (s16) get_unaligned_le16(nodes + 4*i + 2*axis);
+}
+
+static void veikk_calib_fill_coef(struct veikk_calib_coef *coef,
+                                  s32 c00, s32 c10, s32 c01, s32 c11) {
+    coef->a = c00;
+    coef->b = c10-c00;
+    coef->c = c01-c00;
+    coef->d = c11-c10-c01+c00;
+}
+
+// build a mesh (with all cell coefficients precomputed) from an uploaded blob;
+// blob has already been validated
+static struct veikk_calib_mesh *veikk_calib_build(struct veikk *veikk,
+                                                  const u8 *blob,
+                                                  size_t size) {
+    const struct veikk_calib_mesh_hdr *hdr =
+            (const struct veikk_calib_mesh_hdr *) blob;
+    const u8 *nodes = blob + sizeof(struct veikk_calib_mesh_hdr);
+    struct veikk_calib_mesh *mesh;
+    struct veikk_calib_cell *cell;
+    int i, j, n00, ncells = (hdr->cols-1)*(hdr->rows-1);
+
+    if(!(mesh = kzalloc(struct_size(mesh, cells, ncells)+size, GFP_KERNEL)))
+        return NULL;
+
+    mesh->cols = hdr->cols;
+    mesh->rows = hdr->rows;
+    mesh->x_max = veikk->vdinfo->x_max;
+    mesh->y_max = veikk->vdinfo->y_max;
+    mesh->x_scale = div_u64((u64) (mesh->cols-1)<<32, veikk->vdinfo->x_max);
+    mesh->y_scale = div_u64((u64) (mesh->rows-1)<<32, veikk->vdinfo->y_max);
+
+    mesh->blob = (u8 *) &mesh->cells[ncells];
+    mesh->blob_size = size;
+    memcpy(mesh->blob, blob, size);
+
+    for(j=0; j<mesh->rows-1; j++)
+        for(i=0; i<mesh->cols-1; i++) {
+            cell = &mesh->cells[j*(mesh->cols-1)+i];
+            n00 = j*mesh->cols+i;
+            veikk_calib_fill_coef(&cell->dx,
+                    veikk_calib_node(nodes, n00, 0),
+                    veikk_calib_node(nodes, n00+1, 0),
+                    veikk_calib_node(nodes, n00+mesh->cols, 0),
+                    veikk_calib_node(nodes, n00+mesh->cols+1, 0));
+            veikk_calib_fill_coef(&cell->dy,
+                    veikk_calib_node(nodes, n00, 1),
+                    veikk_calib_node(nodes, n00+1, 1),
+                    veikk_calib_node(nodes, n00+mesh->cols, 1),
+                    veikk_calib_node(nodes, n00+mesh->cols+1, 1));
+        }
+    return mesh;
+}
+
+// split a raw coordinate into a cell index and a 16-bit fraction within the
+// cell; coordinates on (or past) the last node belong to the last cell
+static inline void veikk_calib_locate(int pos, u64 scale, int ncells,
+                                      int *idx, s64 *frac) {
+    u64 fp = ((u64) max(pos, 0) * scale) >> (32-VEIKK_CALIB_FRAC_BITS);
+
+    *idx = fp >> VEIKK_CALIB_FRAC_BITS;
+    *frac = fp & (VEIKK_CALIB_ONE-1);
+    if(*idx >= ncells) {
+        *idx = ncells-1;
+        *frac = VEIKK_CALIB_ONE;
+    }
+}
+
+static inline s32 veikk_calib_eval(const struct veikk_calib_coef *coef,
+                                   s64 u, s64 v) {
+    return coef->a + (s32) ((coef->b*u + coef->c*v
+                             + ((coef->d*u) >> VEIKK_CALIB_FRAC_BITS)*v)
+                            >> VEIKK_CALIB_FRAC_BITS);
+}
+
+/**
+ * Apply the device's calibration mesh (if any) to raw digitizer coordinates,
+ * in place. Called from the report path; results are clamped to the physical
+ * range of the digitizer.
+ */
+void veikk_calib_apply(struct veikk *veikk, int *x, int *y) {
+    const struct veikk_calib_mesh *mesh;
+    const struct veikk_calib_cell *cell;
+    int i, j;
+    s64 u, v;
+
+    rcu_read_lock();
+    if((mesh = rcu_dereference(veikk->hot.calib_mesh))) {
+        veikk_calib_locate(*x, mesh->x_scale, mesh->cols-1, &i, &u);
+        veikk_calib_locate(*y, mesh->y_scale, mesh->rows-1, &j, &v);
+        cell = &mesh->cells[j*(mesh->cols-1)+i];
+
+        *x = clamp(*x+veikk_calib_eval(&cell->dx, u, v), 0, mesh->x_max);
+        *y = clamp(*y+veikk_calib_eval(&cell->dy, u, v), 0, mesh->y_max);
+    }
+    rcu_read_unlock();
+}
+
+// free the device's mesh on removal; no reports can arrive at this point
+void veikk_calib_free(struct veikk *veikk) {
+    kfree(rcu_dereference_protected(veikk->hot.calib_mesh, 1));
+    RCU_INIT_POINTER(veikk->hot.calib_mesh, NULL);
+}
+
+static ssize_t calib_mesh_read(struct file *filp, struct kobject *kobj,
+                               struct bin_attribute *attr, char *buf,
+                               loff_t off, size_t count) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(kobj_to_dev(kobj)));
+    struct veikk_calib_mesh_hdr empty = { 0 };
+    const struct veikk_calib_mesh *mesh;
+    ssize_t ret;
+
+    mutex_lock(&veikk_calib_mutex);
+    mesh = rcu_dereference_protected(veikk->hot.calib_mesh,
+                                     lockdep_is_held(&veikk_calib_mutex));
+    ret = mesh
+        ? memory_read_from_buffer(buf, count, &off, mesh->blob,
+                                  mesh->blob_size)
+        : memory_read_from_buffer(buf, count, &off, &empty, sizeof(empty));
+    mutex_unlock(&veikk_calib_mutex);
+    return ret;
+}
+
+static ssize_t calib_mesh_write(struct file *filp, struct kobject *kobj,
+                                struct bin_attribute *attr, char *buf,
+                                loff_t off, size_t count) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(kobj_to_dev(kobj)));
+    struct veikk_calib_mesh_hdr *hdr = (struct veikk_calib_mesh_hdr *) buf;
+    struct veikk_calib_mesh *mesh = NULL, *old;
+
+    // the whole mesh must be written at once; reserved must be zero so that
+    // it can be given a meaning later
+    if(off || count < sizeof(struct veikk_calib_mesh_hdr) || hdr->reserved)
+        return -EINVAL;
+
+    // cols=rows=0 removes the mesh; otherwise check dimensions (see desc)
+    if(hdr->cols || hdr->rows) {
+        if(hdr->cols < 2 || hdr->cols > VEIKK_CALIB_MAX_NODES
+           || hdr->rows < 2 || hdr->rows > VEIKK_CALIB_MAX_NODES
+           || count != VEIKK_CALIB_MESH_SIZE(hdr->cols, hdr->rows))
+            return -EINVAL;
+        if(!(mesh = veikk_calib_build(veikk, buf, count)))
+            return -ENOMEM;
+    } else if(count != sizeof(struct veikk_calib_mesh_hdr)) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&veikk_calib_mutex);
+    old = rcu_replace_pointer(veikk->hot.calib_mesh, mesh,
+                              lockdep_is_held(&veikk_calib_mutex));
+    mutex_unlock(&veikk_calib_mutex);
+
+    if(old)
+        kfree_rcu(old, rcu);
+
+    hid_info(veikk->hdev, "calibration mesh %s\n",
+             mesh ? "updated" : "removed");
+    return count;
+}
+BIN_ATTR_RW(calib_mesh, VEIKK_CALIB_MESH_SIZE(VEIKK_CALIB_MAX_NODES,
+                                              VEIKK_CALIB_MAX_NODES));
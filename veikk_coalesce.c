@@ -0,0 +1,182 @@
+/**
+ * Optional per-device pen report coalescing. Tablets send pen reports at their
+ * full polling rate, and each report becomes several input events plus an
+ * EV_SYN that wakes every listener on the input_dev. With coalescing enabled
+ * (coalesce_us>0), at most one frame is emitted per coalesce_us microseconds;
+ * reports arriving within that window replace each other, and the latest one
+ * is emitted when the window ends. Since reports carry absolute position and
+ * pressure, emitting only the latest report loses no state. Reports that
+ * change the button mask (e.g., pen down/up) are never delayed or dropped.
+ * <p>
+ * Per-device sysfs attributes (in the hid device's sysfs directory):
+ * - coalesce_us:       minimum interval between emitted frames in
+ *                      microseconds, in [0, VEIKK_COALESCE_MAX_US]; 0 disables
+ *                      coalescing (default)
+ * - reports_coalesced: number of reports that were merged into a later frame
+ * - frames_emitted:    number of frames emitted while coalescing was enabled
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/sysfs.h>
+#include "veikk.h"
+
+#define VEIKK_COALESCE_MAX_US   1000000
+
+// emit a report through the device-specific handler and update state; must be
+// called with report_lock held
+static void veikk_coalesce_emit(struct veikk *veikk,
+                                const struct veikk_pen_report *pen_report,
+                                ktime_t now) {
+    (*veikk->vdinfo->emit_pen_report)(veikk, pen_report);
+    veikk->last_emit = now;
+    veikk->hot.last_buttons = pen_report->buttons;
+    veikk->has_pending_report = false;
+    veikk->frames_emitted++;
+}
+
+// end of a coalescing window: flush the latest pending report, if any
+static enum hrtimer_restart veikk_coalesce_timer_fn(struct hrtimer *timer) {
+    struct veikk *veikk = container_of(timer, struct veikk, coalesce_timer);
+    unsigned long flags;
+
+    spin_lock_irqsave(&veikk->report_lock, flags);
+    if(veikk->has_pending_report && !veikk->emit_blocked)
+        veikk_coalesce_emit(veikk, &veikk->pending_report, ktime_get());
+    spin_unlock_irqrestore(&veikk->report_lock, flags);
+    return HRTIMER_NORESTART;
+}
+
+// called once on probe, before any reports can arrive
+void veikk_coalesce_init(struct veikk *veikk) {
+    spin_lock_init(&veikk->report_lock);
+    hrtimer_init(&veikk->coalesce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    veikk->coalesce_timer.function = veikk_coalesce_timer_fn;
+}
+
+/**
+ * Stop all event emission and drop any pending report; used before the
+ * input_devs are torn down (re-registration or removal). Reports that arrive
+ * while blocked are dropped, so nothing can re-arm the window timer or touch
+ * the input_devs until veikk_coalesce_unblock.
+ */
+void veikk_coalesce_block(struct veikk *veikk) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&veikk->report_lock, flags);
+    veikk->emit_blocked = true;
+    veikk->has_pending_report = false;
+    spin_unlock_irqrestore(&veikk->report_lock, flags);
+
+    // can't be re-armed anymore; wait for a running callback to finish
+    hrtimer_cancel(&veikk->coalesce_timer);
+}
+
+// resume event emission once the (new) input_devs are registered
+void veikk_coalesce_unblock(struct veikk *veikk) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&veikk->report_lock, flags);
+    veikk->emit_blocked = false;
+    spin_unlock_irqrestore(&veikk->report_lock, flags);
+}
+
+/**
+ * Entry point from the device-specific raw report handler for a validated pen
+ * report. Emits it immediately if coalescing is disabled, if the button mask
+ * changed, or if the current window has already ended; otherwise stores it as
+ * the pending report to be emitted at the end of the window. All emission
+ * happens under report_lock (uncontended when coalescing is disabled), so
+ * frames from the report path, the window timer and sysfs never interleave.
+ */
+void veikk_coalesce_pen_report(struct veikk *veikk,
+                               const struct veikk_pen_report *pen_report) {
+    unsigned long flags;
+    ktime_t now, deadline;
+    u32 coalesce_us;
+
+    spin_lock_irqsave(&veikk->report_lock, flags);
+    if(veikk->emit_blocked)
+        goto out;
+
+    now = ktime_get();
+
+    // keep the window and button state current (so that enabling coalescing
+    // starts from the last emitted report), but don't count the frame
+    if(!(coalesce_us = veikk->hot.coalesce_us)) {
+        (*veikk->vdinfo->emit_pen_report)(veikk, pen_report);
+        veikk->last_emit = now;
+        veikk->hot.last_buttons = pen_report->buttons;
+        goto out;
+    }
+
+    deadline = ktime_add_us(veikk->last_emit, coalesce_us);
+
+    // a pending report is always superseded by this one
+    if(veikk->has_pending_report)
+        veikk->reports_coalesced++;
+
+    if(pen_report->buttons != veikk->hot.last_buttons
+       || !ktime_before(now, deadline)) {
+        // can't hrtimer_cancel with report_lock held; if the timer fires
+        // anyway, it finds nothing pending
+        hrtimer_try_to_cancel(&veikk->coalesce_timer);
+        veikk_coalesce_emit(veikk, pen_report, now);
+    } else {
+        veikk->pending_report = *pen_report;
+        veikk->has_pending_report = true;
+        if(!hrtimer_active(&veikk->coalesce_timer))
+            hrtimer_start(&veikk->coalesce_timer, deadline, HRTIMER_MODE_ABS);
+    }
+out:
+    spin_unlock_irqrestore(&veikk->report_lock, flags);
+}
+
+static ssize_t coalesce_us_show(struct device *dev,
+                                struct device_attribute *attr, char *buf) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+
+    return sprintf(buf, "%u\n", READ_ONCE(veikk->hot.coalesce_us));
+}
+static ssize_t coalesce_us_store(struct device *dev,
+                                 struct device_attribute *attr,
+                                 const char *buf, size_t count) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    u32 coalesce_us;
+    int error;
+
+    if((error = kstrtouint(buf, 10, &coalesce_us)))
+        return error;
+    if(coalesce_us > VEIKK_COALESCE_MAX_US)
+        return -ERANGE;
+
+    // when disabling, flush the pending report so the last position isn't
+    // lost; a later timer callback then finds nothing pending
+    spin_lock_irqsave(&veikk->report_lock, flags);
+    WRITE_ONCE(veikk->hot.coalesce_us, coalesce_us);
+    if(!coalesce_us && veikk->has_pending_report && !veikk->emit_blocked)
+        veikk_coalesce_emit(veikk, &veikk->pending_report, ktime_get());
+    spin_unlock_irqrestore(&veikk->report_lock, flags);
+
+    if(!coalesce_us)
+        hrtimer_cancel(&veikk->coalesce_timer);
+    return count;
+}
+DEVICE_ATTR_RW(coalesce_us);
+
+static ssize_t reports_coalesced_show(struct device *dev,
+                                      struct device_attribute *attr,
+                                      char *buf) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+
+    return sprintf(buf, "%llu\n", READ_ONCE(veikk->reports_coalesced));
+}
+DEVICE_ATTR_RO(reports_coalesced);
+
+static ssize_t frames_emitted_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+
+    return sprintf(buf, "%llu\n", READ_ONCE(veikk->frames_emitted));
+}
+DEVICE_ATTR_RO(frames_emitted);
@@ -8,6 +8,28 @@
 LIST_HEAD(vdevs);
 DEFINE_MUTEX(vdevs_mutex);
 
+// the per-report state must fit in a single cache line (its alignment comes
+// from ____cacheline_aligned in struct veikk); see struct veikk_hot
+static_assert(sizeof(struct veikk_hot) <= SMP_CACHE_BYTES);
+
+// per-device sysfs attributes, created in the hid device's sysfs directory
+static struct attribute *veikk_attrs[] = {
+    &dev_attr_coalesce_us.attr,
+    &dev_attr_reports_coalesced.attr,
+    &dev_attr_frames_emitted.attr,
+    &dev_attr_relative_mode.attr,
+    &dev_attr_relative_accel.attr,
+    NULL
+};
+static struct bin_attribute *veikk_bin_attrs[] = {
+    &bin_attr_calib_mesh,
+    NULL
+};
+static const struct attribute_group veikk_attr_group = {
+    .attrs = veikk_attrs,
+    .bin_attrs = veikk_bin_attrs
+};
+
 // veikk_input_open/close are used for the input_dev open/close events, never
 // called directly
 int veikk_input_open(struct input_dev *dev) {
@@ -20,17 +42,25 @@ void veikk_input_close(struct input_dev *dev) {
 static int veikk_probe(struct hid_device *hdev,
                        const struct hid_device_id *id) {
     struct veikk *veikk;
+    void *mem;
     int error;
 
     if(!id->driver_data)
         return -EINVAL;
 
-    // alloc kmem for struct veikk associated with driver
-    if(!(veikk = devm_kzalloc(&hdev->dev, sizeof(struct veikk), GFP_KERNEL)))
+    // alloc kmem for struct veikk associated with driver; devm allocations
+    // are only guaranteed to be ARCH_KMALLOC_MINALIGN-aligned, so over-allocate
+    // and align by hand so that veikk->hot really sits on one cache line (the
+    // original allocation is still freed by devres)
+    if(!(mem = devm_kzalloc(&hdev->dev, sizeof(struct veikk)+SMP_CACHE_BYTES-1,
+                            GFP_KERNEL)))
         return -ENOMEM;
+    veikk = PTR_ALIGN(mem, SMP_CACHE_BYTES);
     hid_set_drvdata(hdev, veikk);
     veikk->hdev = hdev;
     veikk->vdinfo = (struct veikk_device_info *) id->driver_data;
+    veikk_coalesce_init(veikk);
+    veikk_rel_init(veikk);
 
     // load/parse report descriptor
     if((error = hid_parse(hdev)))
@@ -51,6 +81,12 @@ static int veikk_probe(struct hid_device *hdev,
         return error;
     }
 
+    if((error = sysfs_create_group(&hdev->dev.kobj, &veikk_attr_group))) {
+        hid_err(hdev, "sysfs_create_group failed\n");
+        hid_hw_stop(hdev);
+        return error;
+    }
+
     // add to vdevs
     mutex_lock(&vdevs_mutex);
     list_add(&veikk->lh, &vdevs);
@@ -63,14 +99,19 @@ static int veikk_probe(struct hid_device *hdev,
 static void veikk_remove(struct hid_device *hdev) {
     struct veikk *veikk = hid_get_drvdata(hdev);
 
-    hid_hw_close(hdev);
-    hid_hw_stop(hdev);
-
-    // remove from vdevs
+    // remove from vdevs first, so that a concurrent module parameter change
+    // can't re-register input_devs on a device that is being torn down
     mutex_lock(&vdevs_mutex);
     list_del(&veikk->lh);
     mutex_unlock(&vdevs_mutex);
 
+    sysfs_remove_group(&hdev->dev.kobj, &veikk_attr_group);
+
+    hid_hw_close(hdev);
+    hid_hw_stop(hdev);
+    veikk_coalesce_block(veikk);
+    veikk_calib_free(veikk);
+
     hid_info(veikk->hdev, "%s removed.\n", veikk->vdinfo->name);
 }
 
@@ -16,6 +16,35 @@
 #include <linux/moduleparam.h>
 #include "veikk.h"
 
+/**
+ * Helper to propagate a module parameter change to all connected devices by
+ * calling each device's handle_modparm_change handler. vdevs_mutex is held for
+ * the whole walk (so that devices can't be probed/removed in the middle of it)
+ * and is always released before returning, even if a handler fails; otherwise
+ * a single failed update would block all later hotplug events (veikk_probe and
+ * veikk_remove also take vdevs_mutex).
+ * <p>
+ * If a handler fails, the remaining devices are still updated so that they
+ * don't get left with stale parameters; the first error is returned.
+ */
+static int veikk_update_vdevs(void) {
+    int error, first_error = 0;
+    struct list_head *lh;
+    struct veikk *veikk;
+
+    mutex_lock(&vdevs_mutex);
+    list_for_each(lh, &vdevs) {
+        veikk = list_entry(lh, struct veikk, lh);
+
+        // TODO: if error, revert all previous changes for consistency?
+        if((error = (*veikk->vdinfo->handle_modparm_change)(veikk))
+           && !first_error)
+            first_error = error;
+    }
+    mutex_unlock(&vdevs_mutex);
+    return first_error;
+}
+
 // GLOBAL MODULE PARAMETERS
 // Note: by spec, unsigned long long is 64+ bits, so functions designed for
 //       unsigned long long are used for u64 module parameters (and the same
@@ -44,8 +73,6 @@ static int veikk_set_veikk_screen_size(const char *val,
                                  const struct kernel_param *kp) {
     int error;
     u32 ss;
-    struct list_head *lh;
-    struct veikk *veikk;
     struct veikk_screen_size screen_size;
 
     if((error = kstrtouint(val, 10, &ss)))
@@ -66,15 +93,8 @@ static int veikk_set_veikk_screen_size(const char *val,
     };
 
     // call device-specific handlers
-    mutex_lock(&vdevs_mutex);
-    list_for_each(lh, &vdevs) {
-        veikk = list_entry(lh, struct veikk, lh);
-
-        // TODO: if error, revert all previous changes for consistency?
-        if((error = (*veikk->vdinfo->handle_modparm_change)(veikk)))
-            return error;
-    }
-    mutex_unlock(&vdevs_mutex);
+    if((error = veikk_update_vdevs()))
+        return error;
     return param_set_uint(val, kp);
 }
 static const struct kernel_param_ops veikk_veikk_screen_size_ops = {
@@ -107,8 +127,6 @@ static int veikk_set_veikk_screen_map(const char *val,
                                       const struct kernel_param *kp) {
     int error;
     u64 sm;
-    struct list_head *lh;
-    struct veikk *veikk;
     struct veikk_screen_map screen_map;
 
     if((error = kstrtoull(val, 10, &sm)))
@@ -127,15 +145,8 @@ static int veikk_set_veikk_screen_map(const char *val,
     };
 
     // call device-specific handlers
-    mutex_lock(&vdevs_mutex);
-    list_for_each(lh, &vdevs) {
-        veikk = list_entry(lh, struct veikk, lh);
-
-        // TODO: if error, revert all previous changes for consistency?
-        if((error = (*veikk->vdinfo->handle_modparm_change)(veikk)))
-            return error;
-    }
-    mutex_unlock(&vdevs_mutex);
+    if((error = veikk_update_vdevs()))
+        return error;
     return param_set_ullong(val, kp);
 }
 static const struct kernel_param_ops veikk_veikk_screen_map_ops = {
@@ -163,8 +174,6 @@ static int veikk_set_veikk_orientation(const char *val,
                                  const struct kernel_param *kp) {
     int error;
     u32 or;
-    struct list_head *lh;
-    struct veikk *veikk;
 
     if((error = kstrtouint(val, 10, &or)))
         return error;
@@ -176,15 +185,8 @@ static int veikk_set_veikk_orientation(const char *val,
     veikk_orientation = (enum veikk_orientation) or;
 
     // call device-specific handlers
-    mutex_lock(&vdevs_mutex);
-    list_for_each(lh, &vdevs) {
-        veikk = list_entry(lh, struct veikk, lh);
-
-        // TODO: if error, revert all previous changes for consistency?
-        if((error = (*veikk->vdinfo->handle_modparm_change)(veikk)))
-            return error;
-    }
-    mutex_unlock(&vdevs_mutex);
+    if((error = veikk_update_vdevs()))
+        return error;
     return param_set_uint(val, kp);
 }
 static const struct kernel_param_ops veikk_orientation_ops = {
@@ -231,8 +233,6 @@ static int veikk_set_pressure_map(const char *val,
                                   const struct kernel_param *kp) {
     int error;
     u64 pm;
-    struct list_head *lh;
-    struct veikk *veikk;
 
     if((error = kstrtoull(val, 10, &pm)))
         return error;
@@ -241,15 +241,8 @@ static int veikk_set_pressure_map(const char *val,
     veikk_pressure_map = *((struct veikk_pressure_map *) &pm);
 
     // call device-specific handlers
-    mutex_lock(&vdevs_mutex);
-    list_for_each(lh, &vdevs) {
-        veikk = list_entry(lh, struct veikk, lh);
-
-        // TODO: if error, revert all previous changes for consistency?
-        if((error = (*veikk->vdinfo->handle_modparm_change)(veikk)))
-            return error;
-    }
-    mutex_unlock(&vdevs_mutex);
+    if((error = veikk_update_vdevs()))
+        return error;
     return param_set_ullong(val, kp);
 }
 static const struct kernel_param_ops veikk_pressure_map_ops = {
@@ -270,7 +263,8 @@ module_param_cb(pressure_map, &veikk_pressure_map_ops,
  * avoid using the global ones (but for now, this function only called with
  * the global ones).
  * <p>
- * In particular, this sets the following settings of the provided struct veikk:
+ * In particular, this sets the following settings of the provided struct veikk
+ * (the axis/direction settings are in its per-report state, veikk->hot):
  * - x_map_axis:    ABS_X if the tablet's x-axis maps to screen's +/- x-axis,
  *                  else ABS_Y
  * - y_map_axis:    same as above, but for tablet's y-axis
@@ -282,11 +276,13 @@ void veikk_configure_input_devs(struct veikk_rect ss,
                                 struct veikk_rect sm,
                                 enum veikk_orientation or,
                                 struct veikk *veikk) {
+    struct veikk_hot *hot = &veikk->hot;
+
     // set veikk_orientation parameters
-    veikk->x_map_axis = (or==VEIKK_OR_DFL||or==VEIKK_OR_FLIP) ? ABS_X : ABS_Y;
-    veikk->y_map_axis = (or==VEIKK_OR_DFL||or==VEIKK_OR_FLIP) ? ABS_Y : ABS_X;
-    veikk->x_map_dir = (or==VEIKK_OR_DFL||or==VEIKK_OR_CW) ? 1 : -1;
-    veikk->y_map_dir = (or==VEIKK_OR_DFL||or==VEIKK_OR_CCW) ? 1 : -1;
+    hot->x_map_axis = (or==VEIKK_OR_DFL||or==VEIKK_OR_FLIP) ? ABS_X : ABS_Y;
+    hot->y_map_axis = (or==VEIKK_OR_DFL||or==VEIKK_OR_FLIP) ? ABS_Y : ABS_X;
+    hot->x_map_dir = (or==VEIKK_OR_DFL||or==VEIKK_OR_CW) ? 1 : -1;
+    hot->y_map_dir = (or==VEIKK_OR_DFL||or==VEIKK_OR_CCW) ? 1 : -1;
 
     // if either sm or ss has zero dimensions, or if sm equal to ss then map to
     // full screen (default mapping; see description for veikk_screen_size and
@@ -303,20 +299,20 @@ void veikk_configure_input_devs(struct veikk_rect ss,
     // bounds for input_dev
     // TODO: document these calculations
     veikk->map_rect = (struct veikk_rect) {
-        .x = -(veikk->x_map_axis==ABS_X
-                        ? (sm.x+(veikk->x_map_dir<0)*sm.width)
+        .x = -(hot->x_map_axis==ABS_X
+                        ? (sm.x+(hot->x_map_dir<0)*sm.width)
                             * veikk->vdinfo->x_max/sm.width
-                        : (sm.y+(veikk->x_map_dir<0)*sm.height)
+                        : (sm.y+(hot->x_map_dir<0)*sm.height)
                             * veikk->vdinfo->x_max/sm.height),
-        .y = -(veikk->y_map_axis==ABS_X
-                        ? (sm.x+(veikk->y_map_dir<0)*sm.width)
+        .y = -(hot->y_map_axis==ABS_X
+                        ? (sm.x+(hot->y_map_dir<0)*sm.width)
                             * veikk->vdinfo->y_max/sm.width
-                        : (sm.y+(veikk->y_map_dir<0)*sm.height)
+                        : (sm.y+(hot->y_map_dir<0)*sm.height)
                             * veikk->vdinfo->y_max/sm.height),
-        .width = veikk->x_map_axis==ABS_X
+        .width = hot->x_map_axis==ABS_X
                     ? ss.width*veikk->vdinfo->x_max/sm.width
                     : ss.height*veikk->vdinfo->x_max/sm.height,
-        .height = veikk->y_map_axis==ABS_X
+        .height = hot->y_map_axis==ABS_X
                  ? ss.width*veikk->vdinfo->y_max/sm.width
                  : ss.height*veikk->vdinfo->y_max/sm.height
     };
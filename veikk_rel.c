@@ -0,0 +1,160 @@
+/**
+ * Per-device relative (mouse) mode. When enabled, pen reports are turned into
+ * relative motion on a separate mouse input_dev (registered alongside the pen
+ * input_dev, so switching modes needs no re-registration), rather than into
+ * absolute events on the pen input_dev. Motion is computed on the mapped
+ * (oriented/calibrated) coordinates, scaled by a fixed-point acceleration
+ * curve, and the sub-count remainder is carried over between reports so that
+ * slow movements aren't lost to rounding.
+ * <p>
+ * Tracking restarts (i.e., the next report produces no motion) on pen lift and
+ * on proximity-out. These tablets don't report an in-range bit, so the pen is
+ * considered out of proximity if no frame arrived for VEIKK_REL_PROX_TIMEOUT_US
+ * (plus the coalescing interval, if any).
+ * <p>
+ * Per-device sysfs attributes (in the hid device's sysfs directory):
+ * - relative_mode:  0 (absolute pen, default) or 1 (relative mouse)
+ * - relative_accel: "gain accel threshold", each in [0, 65535]. With speed s
+ *                   being |dx|+|dy| in tablet units per frame, the output is
+ *                   d*(gain+accel*max(0,s-threshold)/1000)/1000 counts for a
+ *                   movement of d tablet units; i.e., gain is the number of
+ *                   counts per 1000 tablet units at low speed, and accel adds
+ *                   that many counts per 1000 tablet units for every 1000
+ *                   units/frame of speed above threshold
+ *                   default: "100 0 0" (no acceleration)
+ */
+
+#include <linux/math64.h>
+#include <linux/sysfs.h>
+#include "veikk.h"
+
+#define VEIKK_REL_PROX_TIMEOUT_US   100000
+#define VEIKK_REL_SCALE             1000000     // gain*1000 units
+#define VEIKK_REL_PARM_MAX          65535
+
+// called once on probe
+void veikk_rel_init(struct veikk *veikk) {
+    veikk->rel.gain = 100;
+    veikk->rel.accel = 0;
+    veikk->rel.threshold = 0;
+}
+
+/**
+ * Restart relative tracking and release any mouse buttons still held; called
+ * from the report path on a mode switch.
+ */
+void veikk_rel_reset(struct veikk *veikk) {
+    struct input_dev *rel_input = veikk->rel.input;
+
+    veikk->rel.tracking = false;
+    veikk->rel.buttons = 0;
+
+    input_report_key(rel_input, BTN_LEFT, 0);
+    input_report_key(rel_input, BTN_RIGHT, 0);
+    input_report_key(rel_input, BTN_MIDDLE, 0);
+    input_sync(rel_input);
+}
+
+// scale a movement by the acceleration factor, carrying over the remainder
+static inline int veikk_rel_scale(s64 d, s64 factor, s32 *rem) {
+    s64 total = d*factor + *rem;
+
+    return (int) div_s64_rem(total, VEIKK_REL_SCALE, rem);
+}
+
+/**
+ * Emit relative motion and mouse buttons for a pen report with mapped (screen-
+ * oriented) position (x, y) and button mask buttons.
+ */
+void veikk_rel_report(struct veikk *veikk, int x, int y, u8 buttons) {
+    struct veikk_rel *rel = &veikk->rel;
+    struct input_dev *rel_input = veikk->rel.input;
+    ktime_t now = ktime_get();
+    s64 dx, dy, speed, factor;
+    u32 threshold;
+
+    // restart tracking on proximity-out or pen lift; in that case this report
+    // only sets the new reference position
+    if(!rel->tracking
+       || ktime_us_delta(now, rel->last_report) > VEIKK_REL_PROX_TIMEOUT_US
+                                       + READ_ONCE(veikk->hot.coalesce_us)
+       || ((rel->buttons & 0x1) && !(buttons & 0x1))) {
+        rel->tracking = true;
+        rel->rem_x = rel->rem_y = 0;
+    } else {
+        dx = x - rel->last_x;
+        dy = y - rel->last_y;
+        speed = abs(dx) + abs(dy);
+        threshold = READ_ONCE(rel->threshold);
+
+        factor = 1000*(s64) READ_ONCE(rel->gain);
+        if(speed > threshold)
+            factor += READ_ONCE(rel->accel)*(speed-threshold);
+
+        input_report_rel(rel_input, REL_X,
+                         veikk_rel_scale(dx, factor, &rel->rem_x));
+        input_report_rel(rel_input, REL_Y,
+                         veikk_rel_scale(dy, factor, &rel->rem_y));
+    }
+    rel->last_x = x;
+    rel->last_y = y;
+    rel->last_report = now;
+    rel->buttons = buttons;
+
+    input_report_key(rel_input, BTN_LEFT, buttons&0x1);
+    input_report_key(rel_input, BTN_RIGHT, buttons&0x2);
+    input_report_key(rel_input, BTN_MIDDLE, buttons&0x4);
+    input_sync(rel_input);
+}
+
+static ssize_t relative_mode_show(struct device *dev,
+                                  struct device_attribute *attr, char *buf) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+
+    return sprintf(buf, "%u\n", READ_ONCE(veikk->hot.rel_mode));
+}
+static ssize_t relative_mode_store(struct device *dev,
+                                   struct device_attribute *attr,
+                                   const char *buf, size_t count) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+    u32 mode;
+    int error;
+
+    if((error = kstrtouint(buf, 10, &mode)))
+        return error;
+    if(mode > 1)
+        return -ERANGE;
+
+    // the switch itself (releasing buttons, resetting state) happens on the
+    // next report, so that it is serialized with event emission
+    WRITE_ONCE(veikk->hot.rel_mode, mode);
+    return count;
+}
+DEVICE_ATTR_RW(relative_mode);
+
+static ssize_t relative_accel_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+
+    return sprintf(buf, "%u %u %u\n", READ_ONCE(veikk->rel.gain),
+                   READ_ONCE(veikk->rel.accel),
+                   READ_ONCE(veikk->rel.threshold));
+}
+static ssize_t relative_accel_store(struct device *dev,
+                                    struct device_attribute *attr,
+                                    const char *buf, size_t count) {
+    struct veikk *veikk = hid_get_drvdata(to_hid_device(dev));
+    u32 gain, accel, threshold;
+
+    if(sscanf(buf, "%u %u %u", &gain, &accel, &threshold) != 3)
+        return -EINVAL;
+    if(gain > VEIKK_REL_PARM_MAX || accel > VEIKK_REL_PARM_MAX
+       || threshold > VEIKK_REL_PARM_MAX)
+        return -ERANGE;
+
+    WRITE_ONCE(veikk->rel.gain, gain);
+    WRITE_ONCE(veikk->rel.accel, accel);
+    WRITE_ONCE(veikk->rel.threshold, threshold);
+    return count;
+}
+DEVICE_ATTR_RW(relative_accel);
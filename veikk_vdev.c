@@ -18,12 +18,15 @@ static int veikk_s640_alloc_input_devs(struct veikk *veikk) {
     struct hid_device *hdev = veikk->hdev;
 
     // devres_open/close_group to make managing multiple device-associated
-    // allocs easier to clean up; not really useful for the s640 (only has one
-    // input_dev to allocate) but will be useful for the more featured tablets
+    // allocs easier to clean up (the pen input_dev, and the mouse input_dev
+    // used in relative mode)
     if(!devres_open_group(&hdev->dev, veikk, GFP_KERNEL))
         return -ENOMEM;
 
-    if (!(veikk->pen_input = devm_input_allocate_device(&hdev->dev))) {
+    if (!(veikk->hot.pen_input = devm_input_allocate_device(&hdev->dev))
+        || !(veikk->rel.input = devm_input_allocate_device(&hdev->dev))
+        || !(veikk->rel.input->name = devm_kasprintf(&hdev->dev,
+                GFP_KERNEL, "%s Mouse", veikk->vdinfo->name))) {
         devres_release_group(&hdev->dev, veikk);
         return -ENOMEM;
     }
@@ -36,7 +39,9 @@ static int veikk_s640_alloc_input_devs(struct veikk *veikk) {
 // and then call input_register_device; this is called after alloc_input_devs
 static int veikk_s640_setup_and_register_input_devs(struct veikk *veikk) {
     struct hid_device *hdev = veikk->hdev;
-    struct input_dev *pen_input = veikk->pen_input;
+    struct veikk_hot *hot = &veikk->hot;
+    struct input_dev *pen_input = hot->pen_input;
+    struct input_dev *rel_input = veikk->rel.input;
     int error;
 
     // set up input_dev properties
@@ -50,9 +55,17 @@ static int veikk_s640_setup_and_register_input_devs(struct veikk *veikk) {
     pen_input->id.product = hdev->product;
     pen_input->id.version = hdev->version;
 
+    // same for the mouse input_dev (name set on alloc)
+    rel_input->phys = hdev->phys;
+    rel_input->open = veikk_input_open;
+    rel_input->close = veikk_input_close;
+    rel_input->uniq = hdev->uniq;
+    rel_input->id = pen_input->id;
+
     // input's internal struct device (and thus its data store) not the same as
     // that of hdev, so must set its data to point to veikk as well
     input_set_drvdata(pen_input, veikk);
+    input_set_drvdata(rel_input, veikk);
 
     // initialize veikk mapping defaults from vdinfo and calculations from
     // veikk_screen_map and veikk_screen_size module parameters; this doesn't
@@ -65,6 +78,11 @@ static int veikk_s640_setup_and_register_input_devs(struct veikk *veikk) {
     veikk_configure_input_devs(veikk_screen_size, veikk_screen_map,
                                veikk_orientation, veikk);
 
+    // cache the pressure mapping in the per-report state; refreshed on every
+    // re-registration (i.e., whenever pressure_map changes)
+    hot->pressure_map = veikk_pressure_map;
+    hot->pressure_max = veikk->vdinfo->pressure_max;
+
     // set up pen capabilities
     pen_input->evbit[0] |= BIT_MASK(EV_KEY)|BIT_MASK(EV_ABS);
     __set_bit(INPUT_PROP_DIRECT, pen_input->propbit);
@@ -74,28 +92,90 @@ static int veikk_s640_setup_and_register_input_devs(struct veikk *veikk) {
     __set_bit(BTN_STYLUS, pen_input->keybit);
     __set_bit(BTN_STYLUS2, pen_input->keybit);
 
-    input_set_abs_params(pen_input, veikk->x_map_axis, veikk->map_rect.x,
+    input_set_abs_params(pen_input, hot->x_map_axis, veikk->map_rect.x,
                          veikk->map_rect.x+veikk->map_rect.width, 0, 0);
-    input_set_abs_params(pen_input, veikk->y_map_axis, veikk->map_rect.y,
+    input_set_abs_params(pen_input, hot->y_map_axis, veikk->map_rect.y,
                          veikk->map_rect.y+veikk->map_rect.height, 0, 0);
     input_set_abs_params(pen_input, ABS_PRESSURE, 0,
                          veikk->vdinfo->pressure_max, 0, 0);
 
     // TODO: fix resolution (and fuzz, flat) values
-    input_abs_set_res(pen_input, veikk->x_map_axis, veikk->x_map_dir);
-    input_abs_set_res(pen_input, veikk->y_map_axis, veikk->y_map_dir);
+    input_abs_set_res(pen_input, hot->x_map_axis, hot->x_map_dir);
+    input_abs_set_res(pen_input, hot->y_map_axis, hot->y_map_dir);
+
+    // set up mouse capabilities (relative mode); always registered so that
+    // switching modes doesn't require re-registration
+    rel_input->evbit[0] |= BIT_MASK(EV_KEY)|BIT_MASK(EV_REL);
+    __set_bit(INPUT_PROP_POINTER, rel_input->propbit);
+
+    __set_bit(REL_X, rel_input->relbit);
+    __set_bit(REL_Y, rel_input->relbit);
+
+    __set_bit(BTN_LEFT, rel_input->keybit);
+    __set_bit(BTN_RIGHT, rel_input->keybit);
+    __set_bit(BTN_MIDDLE, rel_input->keybit);
 
     if((error = input_register_device(pen_input)))
         return error;
+    if((error = input_register_device(rel_input)))
+        return error;
     return 0;
 }
 
-// emit events from input_dev on input reports
+// emit events from input_dev for a single (validated) pen report; called
+// either directly from the raw report handler or at the end of a coalescing
+// window (see veikk_coalesce.c)
+static void veikk_s640_emit_pen_report(struct veikk *veikk,
+                                       const struct veikk_pen_report
+                                           *pen_report) {
+    struct veikk_hot *hot = &veikk->hot;
+    struct input_dev *pen_input = hot->pen_input;
+    int x = pen_report->x, y = pen_report->y, pos[2];
+    bool rel_mode = READ_ONCE(hot->rel_mode);
+
+    // on a mode switch, release anything still held on either input_dev
+    // (including pressure, for userspace that detects the tip from it) and
+    // restart relative tracking
+    if(unlikely(rel_mode != hot->rel_active)) {
+        input_report_abs(pen_input, ABS_PRESSURE, 0);
+        input_report_key(pen_input, BTN_TOUCH, 0);
+        input_report_key(pen_input, BTN_STYLUS, 0);
+        input_report_key(pen_input, BTN_STYLUS2, 0);
+        input_sync(pen_input);
+        veikk_rel_reset(veikk);
+        hot->rel_active = rel_mode;
+    }
+
+    // correct for sensor nonlinearity before orientation mapping
+    veikk_calib_apply(veikk, &x, &y);
+
+    // relative mode works on screen-oriented coordinates (ABS_X/ABS_Y are
+    // 0/1, so they can be used as indices)
+    if(rel_mode) {
+        pos[hot->x_map_axis] = hot->x_map_dir*x;
+        pos[hot->y_map_axis] = hot->y_map_dir*y;
+        veikk_rel_report(veikk, pos[ABS_X], pos[ABS_Y], pen_report->buttons);
+        return;
+    }
+
+    input_report_abs(pen_input, hot->x_map_axis, hot->x_map_dir*x);
+    input_report_abs(pen_input, hot->y_map_axis, hot->y_map_dir*y);
+    input_report_abs(pen_input, ABS_PRESSURE,
+                     veikk_map_pressure(pen_report->pressure,
+                                        hot->pressure_max,
+                                        &hot->pressure_map));
+
+    input_report_key(pen_input, BTN_TOUCH, pen_report->buttons&0x1);
+    input_report_key(pen_input, BTN_STYLUS, pen_report->buttons&0x2);
+    input_report_key(pen_input, BTN_STYLUS2, pen_report->buttons&0x4);
+
+    // emit EV_SYN on input_devs
+    input_sync(pen_input);
+}
+
+// handle input reports
 static int veikk_s640_handle_raw_data(struct veikk *veikk, u8 *data, int size,
                                       unsigned int report_id) {
-    struct input_dev *pen_input = veikk->pen_input;
-    struct veikk_pen_report *pen_report;
-
     switch(report_id) {
     case VEIKK_PEN_REPORT:
     case VEIKK_STYLUS_REPORT:
@@ -103,29 +183,14 @@ static int veikk_s640_handle_raw_data(struct veikk *veikk, u8 *data, int size,
         if(size != sizeof(struct veikk_pen_report))
             return -EINVAL;
 
-        // dispatch events with input_dev
-        pen_report = (struct veikk_pen_report *) data;
-
-        input_report_abs(pen_input, veikk->x_map_axis,
-                         veikk->x_map_dir*pen_report->x);
-        input_report_abs(pen_input, veikk->y_map_axis,
-                         veikk->y_map_dir*pen_report->y);
-        input_report_abs(pen_input, ABS_PRESSURE,
-                         veikk_map_pressure(pen_report->pressure,
-                                            veikk->vdinfo->pressure_max,
-                                            &veikk_pressure_map));
-
-        input_report_key(pen_input, BTN_TOUCH, pen_report->buttons&0x1);
-        input_report_key(pen_input, BTN_STYLUS, pen_report->buttons&0x2);
-        input_report_key(pen_input, BTN_STYLUS2, pen_report->buttons&0x4);
+        // dispatch events with input_dev (possibly delayed and merged with
+        // later reports if coalescing is enabled)
+        veikk_coalesce_pen_report(veikk, (struct veikk_pen_report *) data);
         break;
     default:
         hid_info(veikk->hdev, "Unknown input report with id %d\n", report_id);
         return 0;
     }
-
-    // on successful data parse and event emission, emit EV_SYN on input_devs
-    input_sync(pen_input);
     return 0;
 }
 // handle module parameter changes by providing all the necessary calculations
@@ -136,24 +201,55 @@ static int veikk_s640_handle_raw_data(struct veikk *veikk, u8 *data, int size,
 static int veikk_s640_handle_modparm_change(struct veikk *veikk) {
     int error;
 
-    // un-register device
-    input_unregister_device(veikk->pen_input);
-    input_free_device(veikk->pen_input);
+    // stop emitting events (and drop any report waiting on the old input_dev)
+    // until the new input_devs are registered; stays blocked on failure
+    veikk_coalesce_block(veikk);
+
+    // un-register device; the input_devs are already gone (and the pointers
+    // NULL) if a previous update failed
+    if(veikk->hot.pen_input) {
+        input_unregister_device(veikk->hot.pen_input);
+        input_free_device(veikk->hot.pen_input);
+        veikk->hot.pen_input = NULL;
+    }
+    if(veikk->rel.input) {
+        input_unregister_device(veikk->rel.input);
+        input_free_device(veikk->rel.input);
+        veikk->rel.input = NULL;
+    }
+
+    // the new mouse input_dev starts with no buttons held and no reference
+    // position; safe to reset here since emission (the only other user of
+    // this state) is blocked until the new input_devs are registered
+    veikk->rel.tracking = false;
+    veikk->rel.buttons = 0;
 
     // re-alloc device
+    // re-alloc device; on failure, alloc_input_devs has already released
+    // whatever it allocated
     if((error = (*veikk->vdinfo->alloc_input_devs)(veikk))) {
         hid_err(veikk->hdev, "alloc_input_devs failed\n");
-        return error;
+        goto fail;
     }
 
-    // re-register device
+    // re-register device; on failure, release the new input_devs (devres
+    // also unregisters the one that may already have been registered)
     if((error = (*veikk->vdinfo->setup_and_register_input_devs)(veikk))) {
         hid_err(veikk->hdev, "setup_and_register_input_devs failed\n");
-        return error;
+        devres_release_group(&veikk->hdev->dev, veikk);
+        goto fail;
     }
+    veikk_coalesce_unblock(veikk);
 
     hid_info(veikk->hdev, "successfully updated module parameters\n");
     return 0;
+
+fail:
+    // leave the device without input_devs (and emission blocked); the next
+    // module parameter change retries from scratch
+    veikk->hot.pen_input = NULL;
+    veikk->rel.input = NULL;
+    return error;
 }
 /** END S640-SPECIFIC CODE **/
 
@@ -167,7 +263,8 @@ struct veikk_device_info veikk_device_info_0x0001 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 // TODO: the following struct veikk_device_infos are provisional, and use the
 //       same handlers as for the S640
@@ -177,7 +274,8 @@ struct veikk_device_info veikk_device_info_0x0002 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 struct veikk_device_info veikk_device_info_0x0003 = {
     .name = "VEIKK A50 Pen", .prod_id = 0x0003,
@@ -185,7 +283,8 @@ struct veikk_device_info veikk_device_info_0x0003 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 struct veikk_device_info veikk_device_info_0x0004 = {
     .name = "VEIKK A15 Pen", .prod_id = 0x004,
@@ -193,7 +292,8 @@ struct veikk_device_info veikk_device_info_0x0004 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 struct veikk_device_info veikk_device_info_0x0006 = {
     .name = "VEIKK A15 Pro Pen", .prod_id = 0x0006,
@@ -201,7 +301,8 @@ struct veikk_device_info veikk_device_info_0x0006 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 struct veikk_device_info veikk_device_info_0x1001 = {
     .name = "VEIKK VK1560 Pen", .prod_id = 0x1001,
@@ -209,7 +310,8 @@ struct veikk_device_info veikk_device_info_0x1001 = {
     .setup_and_register_input_devs = veikk_s640_setup_and_register_input_devs,
     .alloc_input_devs = veikk_s640_alloc_input_devs,
     .handle_raw_data = veikk_s640_handle_raw_data,
-    .handle_modparm_change = veikk_s640_handle_modparm_change
+    .handle_modparm_change = veikk_s640_handle_modparm_change,
+    .emit_pen_report = veikk_s640_emit_pen_report
 };
 /** END struct veikk_device LIST **/
 